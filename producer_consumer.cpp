@@ -4,28 +4,74 @@
 #include <pthread.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
 
-//全局变量 指针
-int in = 0;
-int out = 0;
+//缓冲区中的产品
+typedef struct{
+    int value;              //产品值
+    int priority;           //优先级，越大越紧急
+    double deadline;        //绝对截止时间(秒)，0表示无截止
+    int producer_id;        //生产者id
+}Item;
 
 //同步量
 pthread_mutex_t mutex;
 sem_t full, empty;
 
-//临界区共享资源
+//临界区共享资源：按优先级降序排列，同优先级先进先出
 const int BUFFER_SIZE = 5;
-int buffer[BUFFER_SIZE];
+Item buffer[BUFFER_SIZE];
+int count = 0;
 
 const int TIME_UNIT = 1000000;
 
+//背压水位线：达到高水位开启背压，降到低水位解除
+const int HIGH_WATERMARK = 4;
+const int LOW_WATERMARK = 2;
+int backpressure = 0;
+
+//退避参数(秒)与重试上限
+const float BACKOFF_BASE = 0.5;
+const float BACKOFF_MAX = 4.0;
+const int MAX_RETRIES = 3;
+//不低于该优先级的产品忽略背压
+const int URGENT_PRIORITY = 5;
+
+//超时策略：生产者可用B/D/R/S，消费者可用B/D/R(D表示放弃消费)
+const char POLICY_BLOCK = 'B';   //一直阻塞等待
+const char POLICY_DROP = 'D';    //超时即丢弃
+const char POLICY_RETRY = 'R';   //超时后退避重试
+const char POLICY_SHED = 'S';    //超时后挤掉缓冲区中优先级更低的产品(仅生产者)
+
+//统计
+int produced_count = 0, consumed_count = 0;
+int dropped_count = 0, shed_count = 0, expired_count = 0;
+
+double start_time;
+
+//尚未结束的生产者数与消费者总数，最后一个生产者结束时用来唤醒消费者
+int producers_left = 0;
+int num_of_consumers = 0;
+
 typedef struct{
     int id;                 //线程id
-    char type;              //读/写
+    char type;              //生产/消费
     float delay_time;       //进入时间
     float duration_time;    //操作时间
+    int priority;           //产品优先级(仅生产者)
+    float deadline;         //相对启动的截止时间，0表示无截止(仅生产者)
+    float timeout;          //等待超时，0表示一直阻塞
+    char policy;            //超时策略，生产者B/D/R/S，消费者B/D/R
 }ThreadInfo;
 
+// 检查超时策略是否适用于该类型的线程
+int is_valid_policy(char type, char policy){
+    if(policy == POLICY_BLOCK || policy == POLICY_DROP || policy == POLICY_RETRY){
+        return 1;
+    }
+    return type == 'P' && policy == POLICY_SHED;
+}
+
 int read_threads_from_file(const char* file_name, ThreadInfo** threads){
     FILE* file = fopen(file_name, "r");
     if(!file){
@@ -42,12 +88,29 @@ int read_threads_from_file(const char* file_name, ThreadInfo** threads){
     *threads = (ThreadInfo*)malloc(count * sizeof(ThreadInfo));
     int i = 0;
     while(fgets(line, sizeof(line), file)){
-        sscanf(line, "%d %c %f %f",
+        //后四列可省略：优先级 截止时间 超时 策略
+        //消费者只使用超时与策略两列，策略不能为S
+        (*threads)[i].priority = 0;
+        (*threads)[i].deadline = 0;
+        (*threads)[i].timeout = 0;
+        (*threads)[i].policy = POLICY_BLOCK;
+        sscanf(line, "%d %c %f %f %d %f %f %c",
             &(*threads)[i].id,
             &(*threads)[i].type,
             &(*threads)[i].delay_time,
-            &(*threads)[i].duration_time
+            &(*threads)[i].duration_time,
+            &(*threads)[i].priority,
+            &(*threads)[i].deadline,
+            &(*threads)[i].timeout,
+            &(*threads)[i].policy
         );
+        if(!is_valid_policy((*threads)[i].type, (*threads)[i].policy)){
+            printf("line %d: unknown policy '%c' for %s %d\n", i + 1, (*threads)[i].policy,
+                   (*threads)[i].type == 'P' ? "Producer" : "Consumer", (*threads)[i].id);
+            fclose(file);
+            free(*threads);
+            return -1;
+        }
         i++;
     }
 
@@ -64,6 +127,148 @@ char* get_time_str() {
     return buf;
 }
 
+// 单调时钟的当前时间(秒)
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 带超时的信号量等待，timeout为0时一直阻塞；超时返回-1
+int sem_wait_for(sem_t* sem, float timeout) {
+    if(timeout <= 0){
+        return sem_wait(sem);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long long ns = ts.tv_nsec + (long long)(timeout * 1e9);
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    int ret;
+    while((ret = sem_timedwait(sem, &ts)) == -1 && errno == EINTR);
+    return ret;
+}
+
+// 按优先级插入，同优先级排在已有产品之后(需持有mutex且有空位)
+void buffer_insert(Item item) {
+    int pos = count;
+    while(pos > 0 && buffer[pos - 1].priority < item.priority){
+        buffer[pos] = buffer[pos - 1];
+        pos--;
+    }
+    buffer[pos] = item;
+    count++;
+}
+
+// 取出下标为pos的产品(需持有mutex)
+Item buffer_remove(int pos) {
+    Item item = buffer[pos];
+    for(int i = pos; i < count - 1; i++){
+        buffer[i] = buffer[i + 1];
+    }
+    count--;
+    return item;
+}
+
+// 在mutex保护下读取背压标志
+int is_backpressure() {
+    pthread_mutex_lock(&mutex);
+    int on = backpressure;
+    pthread_mutex_unlock(&mutex);
+    return on;
+}
+
+// 根据水位线更新背压标志(需持有mutex)
+void update_backpressure() {
+    if(!backpressure && count >= HIGH_WATERMARK){
+        backpressure = 1;
+        printf("[%s] Buffer: Backpressure ON, buffer count: %d\n", get_time_str(), count);
+    }else if(backpressure && count <= LOW_WATERMARK){
+        backpressure = 0;
+        printf("[%s] Buffer: Backpressure OFF, buffer count: %d\n", get_time_str(), count);
+    }
+}
+
+// 产品是否已过截止时间
+int is_expired(const Item* item) {
+    return item->deadline > 0 && now_sec() > item->deadline;
+}
+
+// 选出可被替换的产品：优先过期产品，允许挤占时其次为优先级更低的末尾产品；没有返回-1(需持有mutex)
+int find_victim(int priority, int allow_shed) {
+    for(int i = count - 1; i >= 0; i--){
+        if(is_expired(&buffer[i])){
+            return i;
+        }
+    }
+    if(allow_shed && count > 0 && buffer[count - 1].priority < priority){
+        return count - 1;
+    }
+    return -1;
+}
+
+// 替换缓冲区中的一个产品，沿用其槽位，full/empty计数都不变
+// 成功返回1，无可替换产品返回0，本产品已过期返回-1
+int try_replace(ThreadInfo* info, Item item, int allow_shed) {
+    pthread_mutex_lock(&mutex);
+    if(is_expired(&item)){
+        pthread_mutex_unlock(&mutex);
+        return -1;
+    }
+    if(find_victim(item.priority, allow_shed) < 0){
+        pthread_mutex_unlock(&mutex);
+        return 0;
+    }
+    printf("[%s] Producer %d: Acquired buffer lock to replace an item\n", get_time_str(), info->id);
+
+    //与正常放置相同的生产耗时，之后重新选择(期间可能有产品过期)
+    usleep(info->duration_time * TIME_UNIT);
+    Item victim = buffer_remove(find_victim(item.priority, allow_shed));
+    buffer_insert(item);
+    produced_count++;
+    if(is_expired(&victim)){
+        expired_count++;
+        printf("[%s] Producer %d: Replaced expired item %d (priority %d) from Producer %d, "
+               "produced item %d (priority %d), buffer count: %d\n", 
+               get_time_str(), info->id, victim.value, victim.priority, 
+               victim.producer_id, item.value, item.priority, count);
+    }else{
+        shed_count++;
+        printf("[%s] Producer %d: Shed item %d (priority %d) from Producer %d, "
+               "produced item %d (priority %d), buffer count: %d\n", 
+               get_time_str(), info->id, victim.value, victim.priority, 
+               victim.producer_id, item.value, item.priority, count);
+    }
+
+    pthread_mutex_unlock(&mutex);
+    printf("[%s] Producer %d: Released buffer lock, reused slot without signaling\n", 
+           get_time_str(), info->id);
+    return 1;
+}
+
+// 丢弃未能放入缓冲区的产品
+void drop_item(ThreadInfo* info, Item item, const char* reason) {
+    pthread_mutex_lock(&mutex);
+    dropped_count++;
+    pthread_mutex_unlock(&mutex);
+    printf("[%s] Producer %d: Dropped item %d (%s)\n", get_time_str(), info->id, item.value, reason);
+}
+
+// 生产者结束；最后一个生产者为每个消费者补发一次full，
+// 让因丢弃过期产品或产品被丢弃而仍在等待的消费者能醒来并退出
+void producer_finish(ThreadInfo* info) {
+    pthread_mutex_lock(&mutex);
+    int last = --producers_left == 0;
+    pthread_mutex_unlock(&mutex);
+    if(last){
+        printf("[%s] Producer %d: Last producer, waking waiting consumers\n", get_time_str(), info->id);
+        for(int i = 0; i < num_of_consumers; i++){
+            sem_post(&full);
+        }
+    }
+    printf("Producer %d: Finished\n", info->id);
+}
+
 void* ProducerThread(void* arg){
     ThreadInfo* info = (ThreadInfo*)arg;
     
@@ -74,27 +279,88 @@ void* ProducerThread(void* arg){
     printf("[%s] Producer %d: Started\n", get_time_str(), info->id);
 
     //生产出产品
-    int item = rand() % 100;
+    Item item;
+    item.value = rand() % 100;
+    item.priority = info->priority;
+    item.deadline = info->deadline > 0 ? start_time + info->deadline : 0;
+    item.producer_id = info->id;
+
+    //背压：非紧急产品先指数退避，缓冲区回落后再尝试
+    float backoff = BACKOFF_BASE;
+    for(int round = 0; item.priority < URGENT_PRIORITY && round < MAX_RETRIES && is_backpressure(); round++){
+        printf("[%s] Producer %d: Backpressure, backing off %.1f seconds\n", 
+               get_time_str(), info->id, backoff);
+        usleep(backoff * TIME_UNIT);
+        backoff = backoff * 2 < BACKOFF_MAX ? backoff * 2 : BACKOFF_MAX;
+    }
+
+    //先尝试回收过期产品占用的槽位
+    int ret = try_replace(info, item, 0);
+    if(ret != 0){
+        if(ret < 0) drop_item(info, item, "deadline passed");
+        producer_finish(info);
+        return NULL;
+    }
+
+    int retries = 0;
+    backoff = BACKOFF_BASE;
+    printf("[%s] Producer %d: Waiting for empty slot (priority %d)\n", 
+           get_time_str(), info->id, item.priority);
+    while(sem_wait_for(&empty, info->timeout) != 0){
+        printf("[%s] Producer %d: Timed out waiting for empty slot\n", get_time_str(), info->id);
+
+        //过期产品总可被替换，S策略还可挤掉优先级更低的产品
+        ret = try_replace(info, item, info->policy == POLICY_SHED);
+        if(ret != 0){
+            if(ret < 0) drop_item(info, item, "deadline passed");
+            producer_finish(info);
+            return NULL;
+        }
+
+        if(info->policy == POLICY_BLOCK){
+            continue;
+        }
+        if(info->policy == POLICY_RETRY && retries < MAX_RETRIES){
+            retries++;
+            printf("[%s] Producer %d: Retry %d after %.1f seconds\n", 
+                   get_time_str(), info->id, retries, backoff);
+            usleep(backoff * TIME_UNIT);
+            backoff = backoff * 2 < BACKOFF_MAX ? backoff * 2 : BACKOFF_MAX;
+            continue;
+        }
+
+        drop_item(info, item, "timed out");
+        producer_finish(info);
+        return NULL;
+    }
 
-    printf("[%s] Producer %d: Waiting for empty slot\n", get_time_str(), info->id);
-    sem_wait(&empty);
     printf("[%s] Producer %d: Trying to acquire buffer lock\n", get_time_str(), info->id);
     pthread_mutex_lock(&mutex);
     printf("[%s] Producer %d: Acquired buffer lock\n", get_time_str(), info->id);
 
+    //等待期间已过截止时间则不再占用槽位，归还empty
+    if(is_expired(&item)){
+        pthread_mutex_unlock(&mutex);
+        sem_post(&empty);
+        drop_item(info, item, "deadline passed");
+        producer_finish(info);
+        return NULL;
+    }
+
     //延时放置
     usleep(info->duration_time * TIME_UNIT);
-    buffer[in] = item;
-    in = (in + 1) % BUFFER_SIZE;
-    printf("[%s] Producer %d: Produced item %d, buffer count: %d\n", 
-           get_time_str(),info->id, item, (in - out + BUFFER_SIZE) % BUFFER_SIZE);
+    buffer_insert(item);
+    produced_count++;
+    printf("[%s] Producer %d: Produced item %d (priority %d), buffer count: %d\n", 
+           get_time_str(),info->id, item.value, item.priority, count);
+    update_backpressure();
 
     pthread_mutex_unlock(&mutex);
     printf("[%s] Producer %d: Released buffer lock\n", get_time_str(), info->id);
     sem_post(&full);    //给消费者发一个信号
     printf("[%s] Producer %d: Signaled full semaphore\n", get_time_str(), info->id);
 
-    printf("Producer %d: Finished\n", info->id);
+    producer_finish(info);
     return NULL;
 }
 
@@ -107,23 +373,65 @@ void* ConsumerThread(void* arg){
     usleep(info->delay_time * TIME_UNIT);
     printf("[%s] Consumer %d: Started\n", get_time_str(), info->id);
 
-    printf("[%s] Consumer %d: Waiting for full slot\n", get_time_str(), info->id);
-    sem_wait(&full);
-    printf("[%s] Consumer %d: Trying to acquire buffer lock\n", get_time_str(), info->id);
-    pthread_mutex_lock(&mutex);
-    printf("[%s] Consumer %d: Acquired buffer lock\n", get_time_str(), info->id);
+    int retries = 0;
+    float backoff = BACKOFF_BASE;
+    while(1){
+        printf("[%s] Consumer %d: Waiting for full slot\n", get_time_str(), info->id);
+        if(sem_wait_for(&full, info->timeout) != 0){
+            printf("[%s] Consumer %d: Timed out waiting for full slot\n", get_time_str(), info->id);
+            if(info->policy == POLICY_BLOCK){
+                continue;
+            }
+            if(info->policy == POLICY_RETRY && retries < MAX_RETRIES){
+                retries++;
+                printf("[%s] Consumer %d: Retry %d after %.1f seconds\n", 
+                       get_time_str(), info->id, retries, backoff);
+                usleep(backoff * TIME_UNIT);
+                backoff = backoff * 2 < BACKOFF_MAX ? backoff * 2 : BACKOFF_MAX;
+                continue;
+            }
+            printf("[%s] Consumer %d: Gave up\n", get_time_str(), info->id);
+            printf("Consumer %d: Finished\n", info->id);
+            return NULL;
+        }
+        printf("[%s] Consumer %d: Trying to acquire buffer lock\n", get_time_str(), info->id);
+        pthread_mutex_lock(&mutex);
+        printf("[%s] Consumer %d: Acquired buffer lock\n", get_time_str(), info->id);
 
-    //延时取出
-    usleep(info->duration_time * TIME_UNIT);
-    int item = buffer[out];
-    out = (out + 1) % BUFFER_SIZE;
-    printf("[%s] Consumer %d: Consumed item %d, buffer count: %d\n", 
-           get_time_str(),info->id, item, (in - out + BUFFER_SIZE) % BUFFER_SIZE);
+        //缓冲区为空说明是最后一个生产者补发的信号，不会再有产品
+        if(count == 0){
+            pthread_mutex_unlock(&mutex);
+            printf("[%s] Consumer %d: No more items coming, gave up\n", get_time_str(), info->id);
+            printf("Consumer %d: Finished\n", info->id);
+            return NULL;
+        }
 
-    pthread_mutex_unlock(&mutex);
-    printf("[%s] Consumer %d: Released buffer lock\n", get_time_str(), info->id);
-    sem_post(&empty);
-    printf("[%s] Consumer %d: Signaled empty semaphore\n", get_time_str(), info->id);
+        //取优先级最高的产品，已过截止时间的直接丢弃并继续等待
+        Item item = buffer_remove(0);
+        if(item.deadline > 0 && now_sec() > item.deadline){
+            expired_count++;
+            printf("[%s] Consumer %d: Discarded expired item %d (priority %d) from Producer %d, "
+                   "buffer count: %d\n", 
+                   get_time_str(), info->id, item.value, item.priority, item.producer_id, count);
+            update_backpressure();
+            pthread_mutex_unlock(&mutex);
+            sem_post(&empty);
+            continue;
+        }
+
+        //延时取出
+        usleep(info->duration_time * TIME_UNIT);
+        consumed_count++;
+        printf("[%s] Consumer %d: Consumed item %d (priority %d), buffer count: %d\n", 
+               get_time_str(),info->id, item.value, item.priority, count);
+        update_backpressure();
+
+        pthread_mutex_unlock(&mutex);
+        printf("[%s] Consumer %d: Released buffer lock\n", get_time_str(), info->id);
+        sem_post(&empty);
+        printf("[%s] Consumer %d: Signaled empty semaphore\n", get_time_str(), info->id);
+        break;
+    }
     
     printf("Consumer %d: Finished\n", info->id);
     return NULL;
@@ -142,6 +450,11 @@ int main(int argc, char* argv[]){
     pthread_mutex_init(&mutex, NULL);
     sem_init(&empty, 0, BUFFER_SIZE);
     sem_init(&full, 0, 0);
+    start_time = now_sec();
+    for(int i = 0; i < num_of_threads; i++){
+        if(threads[i].type == 'P') producers_left++;
+        else num_of_consumers++;
+    }
 
     printf("\n===== Starting %d threads =====\n", num_of_threads);
     //创建线程id
@@ -161,6 +474,8 @@ int main(int argc, char* argv[]){
     }
 
     printf("\n===== All threads completed =====\n");
+    printf("Produced: %d, Consumed: %d, Dropped: %d, Shed: %d, Expired: %d, Left in buffer: %d\n",
+           produced_count, consumed_count, dropped_count, shed_count, expired_count, count);
 
     //清理资源
     free(threads);